@@ -1,5 +1,6 @@
 #ifndef __LOAD_CONFIG_H__
 #define __LOAD_CONFIG_H__
+#include <cstdint>
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <string>
@@ -19,9 +20,11 @@ namespace RabbitMQCpp {
   class ConsumerConfiguration {
    public:
     ConsumerConfiguration() = delete;
-    ConsumerConfiguration(const int chanId) : channelId(chanId) {}
+    ConsumerConfiguration(const int chanId) : channelId(chanId), manualAck(false), prefetchCount(0) {}
 
     int channelId;
+    bool manualAck;          //  direct consumers auto-ack unless this is set; every consume path then acks
+    uint16_t prefetchCount;  //  0 leaves the broker default (unlimited)
 
     virtual ~ConsumerConfiguration() = default;
   };
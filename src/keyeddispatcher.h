@@ -0,0 +1,271 @@
+#ifndef __KEYEDDISPATCHER_H__
+#define __KEYEDDISPATCHER_H__
+
+#include <rabbitmq-c/amqp.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RabbitMQCpp {
+  struct PoolDeleter {
+    void operator()(amqp_pool_t *pool) const {
+      empty_amqp_pool(pool);
+      delete pool;
+    }
+  };
+
+  //  an owned copy of a delivery; the envelope it came from is destroyed before the handler runs. String
+  //  properties are empty when absent; headers is a deep copy held in headerPool.
+  struct Delivery {
+    amqp_channel_t channel;
+    uint64_t deliveryTag;
+    bool redelivered;
+    std::string consumerTag;
+    std::string exchange;
+    std::string routingKey;
+    std::string body;
+    std::string contentType;
+    std::string correlationId;
+    std::string replyTo;
+    std::string messageId;
+    amqp_table_t headers{};
+    std::unique_ptr<amqp_pool_t, PoolDeleter> headerPool;
+  };
+
+  //  the value of a string-valued entry in a field table
+  inline std::optional<std::string> findStringHeader(const amqp_table_t &table, const std::string &name) {
+    for (int i = 0; i < table.num_entries; ++i) {
+      const auto &entry = table.entries[i];
+      if (entry.key.len == name.size() && std::memcmp(entry.key.bytes, name.data(), name.size()) == 0 &&
+          (entry.value.kind == AMQP_FIELD_KIND_UTF8 || entry.value.kind == AMQP_FIELD_KIND_BYTES)) {
+        const auto &value = entry.value.value.bytes;
+        return std::string(static_cast<const char *>(value.bytes), value.len);
+      }
+    }
+    return std::nullopt;
+  }
+
+  using ParallelCallback = std::function<void(const Delivery &)>;
+  using KeyExtractor = std::function<std::string(const amqp_envelope_t &)>;
+
+  //  what the I/O thread has to tell the broker: individual rejections first, then one multiple=true ack
+  struct Settlement {
+    std::vector<uint64_t> rejected;
+    uint64_t ackUpTo;
+  };
+
+  //  tracks the highest delivery tag below which every delivery has completed
+  class AckWatermark {
+   public:
+    AckWatermark() : started(false), watermark(0), issued(0) {}
+
+    void dispatched(const uint64_t tag) {
+      std::lock_guard lock(mtx);
+      if (!started) {
+        watermark = issued = tag - 1;
+        started = true;
+      }
+    }
+
+    void completed(const uint64_t tag, const bool failed = false) {
+      std::lock_guard lock(mtx);
+      done.insert(tag);
+      if (failed) {
+        rejected.push_back(tag);
+        nacked.insert(tag);
+      }
+    }
+
+    //  the broker looks up a multiple=true ack by its exact tag, so ackUpTo must not be a tag that is being
+    //  nacked; it is the highest non-rejected tag the watermark has newly passed, or 0 if there is none
+    Settlement collect() {
+      std::lock_guard lock(mtx);
+      while (!done.empty() && *done.begin() == watermark + 1) {
+        done.erase(done.begin());
+        ++watermark;
+      }
+
+      Settlement settlement{std::move(rejected), 0};
+      rejected.clear();
+
+      auto tag = watermark;
+      while (tag > issued && nacked.contains(tag)) {
+        --tag;
+      }
+      if (tag > issued) {
+        settlement.ackUpTo = tag;
+      }
+      issued = watermark;
+      nacked.erase(nacked.begin(), nacked.upper_bound(watermark));
+
+      return settlement;
+    }
+
+   private:
+    std::mutex mtx;
+    bool started;
+    uint64_t watermark;
+    uint64_t issued;
+    std::set<uint64_t> done;
+    std::set<uint64_t> nacked;
+    std::vector<uint64_t> rejected;
+  };  // AckWatermark
+
+  //  hashes each delivery to one of a fixed set of serial lanes, each drained by its own worker thread;
+  //  deliveries sharing a key are handled in arrival order, different keys run in parallel
+  class KeyedDispatcher {
+   public:
+    KeyedDispatcher(ParallelCallback callback, const unsigned laneCount = std::thread::hardware_concurrency(),
+                    KeyExtractor extractor = routingKey)
+        : handler(std::move(callback)), keyOf(std::move(extractor)) {
+      const auto count = std::max(laneCount, 1u);
+      lanes.reserve(count);
+      for (unsigned i = 0; i < count; ++i) {
+        lanes.push_back(std::make_unique<Lane>());
+      }
+      for (auto &lane : lanes) {
+        lane->worker = std::jthread([this, &l = *lane](std::stop_token stop) { drain(l, stop); });
+      }
+    }
+
+    KeyedDispatcher(const KeyedDispatcher &) = delete;
+    KeyedDispatcher &operator=(const KeyedDispatcher &) = delete;
+
+    ~KeyedDispatcher() {
+      for (auto &lane : lanes) {
+        lane->worker.request_stop();
+      }
+      for (auto &lane : lanes) {
+        if (lane->worker.joinable()) {
+          lane->worker.join();
+        }
+      }
+    }
+
+    //  called on the I/O thread while the envelope is still alive. The tag is registered before anything
+    //  that can throw; a delivery that never reaches a lane is recorded as failed so it is nacked and
+    //  does not leave a hole the watermark can never pass.
+    void dispatch(const amqp_envelope_t &envelope) {
+      watermark.dispatched(envelope.delivery_tag);
+
+      Lane *target;
+      Delivery delivery;
+      try {
+        target = lanes[std::hash<std::string>{}(keyOf(envelope)) % lanes.size()].get();
+        delivery = copyDelivery(envelope);
+      } catch (...) {
+        watermark.completed(envelope.delivery_tag, true);
+        throw;
+      }
+
+      auto &lane = *target;
+      {
+        std::lock_guard lock(lane.mtx);
+        lane.pending.push_back(std::move(delivery));
+      }
+      lane.cv.notify_one();
+    }
+
+    Settlement collect() { return watermark.collect(); }
+
+    static std::string routingKey(const amqp_envelope_t &envelope) {
+      return byteString(envelope.routing_key);
+    }
+
+    //  keys on a string-valued header, falling back to the routing key when it is absent
+    static KeyExtractor headerKey(const std::string &name) {
+      return [name](const amqp_envelope_t &envelope) {
+        const auto &props = envelope.message.properties;
+        if (props._flags & AMQP_BASIC_HEADERS_FLAG) {
+          if (auto value = findStringHeader(props.headers, name)) {
+            return *value;
+          }
+        }
+        return routingKey(envelope);
+      };
+    }
+
+   private:
+    struct Lane {
+      std::mutex mtx;
+      std::condition_variable_any cv;
+      std::deque<Delivery> pending;
+      std::jthread worker;
+    };
+
+    ParallelCallback handler;
+    KeyExtractor keyOf;
+    AckWatermark watermark;
+    std::vector<std::unique_ptr<Lane>> lanes;
+
+    void drain(Lane &lane, std::stop_token stop) {
+      while (true) {
+        Delivery delivery;
+        {
+          std::unique_lock lock(lane.mtx);
+          if (!lane.cv.wait(lock, stop, [&lane] { return !lane.pending.empty(); })) {
+            return;
+          }
+          delivery = std::move(lane.pending.front());
+          lane.pending.pop_front();
+        }
+
+        bool failed = false;
+        try {
+          handler(delivery);
+        } catch (...) {
+          failed = true;
+        }
+        watermark.completed(delivery.deliveryTag, failed);
+      }
+    }
+
+    static Delivery copyDelivery(const amqp_envelope_t &envelope) {
+      const auto &props = envelope.message.properties;
+      auto property = [&props](const amqp_flags_t flag, const amqp_bytes_t &value) {
+        return props._flags & flag ? byteString(value) : std::string();
+      };
+
+      Delivery delivery;
+      delivery.channel = envelope.channel;
+      delivery.deliveryTag = envelope.delivery_tag;
+      delivery.redelivered = static_cast<bool>(envelope.redelivered);
+      delivery.consumerTag = byteString(envelope.consumer_tag);
+      delivery.exchange = byteString(envelope.exchange);
+      delivery.routingKey = byteString(envelope.routing_key);
+      delivery.body = byteString(envelope.message.body);
+      delivery.contentType = property(AMQP_BASIC_CONTENT_TYPE_FLAG, props.content_type);
+      delivery.correlationId = property(AMQP_BASIC_CORRELATION_ID_FLAG, props.correlation_id);
+      delivery.replyTo = property(AMQP_BASIC_REPLY_TO_FLAG, props.reply_to);
+      delivery.messageId = property(AMQP_BASIC_MESSAGE_ID_FLAG, props.message_id);
+
+      if ((props._flags & AMQP_BASIC_HEADERS_FLAG) && props.headers.num_entries > 0) {
+        delivery.headerPool.reset(new amqp_pool_t);
+        init_amqp_pool(delivery.headerPool.get(), 4096);
+        auto status = amqp_table_clone(&props.headers, &delivery.headers, delivery.headerPool.get());
+        if (status != AMQP_STATUS_OK) {
+          throw std::runtime_error("copy headers failed");
+        }
+      }
+      return delivery;
+    }
+
+    static std::string byteString(const amqp_bytes_t &bytes) {
+      return std::string(static_cast<const char *>(bytes.bytes), bytes.len);
+    }
+  };  // KeyedDispatcher
+};  // namespace RabbitMQCpp
+#endif
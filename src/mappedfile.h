@@ -0,0 +1,75 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <stdexcept>
+
+namespace RabbitMQCpp {
+  //  read-only, sequentially advised mapping of a whole file
+  class MappedFile {
+   public:
+    MappedFile(const std::filesystem::path &path) : base(nullptr), length(0), released(0) {
+      auto fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw std::runtime_error(std::format("open {} failed: {}", path.string(), std::strerror(errno)));
+      }
+
+      struct stat st;
+      if (::fstat(fd, &st) != 0) {
+        auto err = errno;
+        ::close(fd);
+        throw std::runtime_error(std::format("stat {} failed: {}", path.string(), std::strerror(err)));
+      }
+      length = static_cast<std::size_t>(st.st_size);
+
+      if (length) {
+        auto addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+          auto err = errno;
+          ::close(fd);
+          throw std::runtime_error(std::format("mmap {} failed: {}", path.string(), std::strerror(err)));
+        }
+        base = static_cast<char *>(addr);
+        ::madvise(base, length, MADV_SEQUENTIAL);
+      }
+      ::close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+      if (base) {
+        ::munmap(base, length);
+      }
+    }
+
+    const char *data() const { return base; }
+    std::size_t size() const { return length; }
+
+    //  drop the pages wholly below offset from the resident set; they have been sent and are not read again
+    void release(const std::size_t offset) {
+      const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+      const auto end = offset / page * page;
+      if (base && end > released) {
+        ::madvise(base + released, end - released, MADV_DONTNEED);
+        released = end;
+      }
+    }
+
+   private:
+    char *base;
+    std::size_t length;
+    std::size_t released;
+  };  // MappedFile
+};  // namespace RabbitMQCpp
+#endif
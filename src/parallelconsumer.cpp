@@ -0,0 +1,47 @@
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <syncstream>
+#include <thread>
+
+#include "config.h"
+#include "keyeddispatcher.h"
+#include "rabbitmqconsumer.h"
+
+using json = nlohmann::json;
+using namespace std::string_literals;
+
+void handle(const RabbitMQCpp::Delivery &delivery);
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    throw std::runtime_error("Queue name missing");
+  }
+  auto connConfig = RabbitMQCpp::loadConnectionConfiguration("config/config.json");
+
+  RabbitMQCpp::DirectConsumerConfiguration consumerConfig(argv[1]);
+  consumerConfig.manualAck = true;
+  consumerConfig.prefetchCount = 256;
+
+  RabbitMQCpp::RabbitMQDirectConsumer consumer;
+  consumer.login(connConfig);
+  consumer.prepare(consumerConfig, [](amqp_channel_t, amqp_bytes_t &, amqp_message_t &) {});
+
+  //  optional second argument keys deliveries on a header instead of the routing key
+  RabbitMQCpp::KeyedDispatcher dispatcher(handle, std::thread::hardware_concurrency(),
+                                          argc > 2 ? RabbitMQCpp::KeyedDispatcher::headerKey(argv[2])
+                                                   : RabbitMQCpp::KeyedDispatcher::routingKey);
+
+  while (true) {
+    consumer.consume(dispatcher);
+  }
+
+  return 0;
+}
+
+void handle(const RabbitMQCpp::Delivery &delivery) {
+  std::osyncstream(std::cout) << "LANE " << std::this_thread::get_id() << " TAG " << delivery.deliveryTag
+                              << " " << delivery.body << "\n";
+}
@@ -3,25 +3,47 @@
 
 #include <rabbitmq-c/amqp.h>
 #include <rabbitmq-c/tcp_socket.h>
+#include <sys/time.h>
 
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <exception>
 #include <filesystem>
 #include <format>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "config.h"
+#include "keyeddispatcher.h"
 
 namespace RabbitMQCpp {
   using ConsumerCallback = std::function<void(amqp_channel_t, amqp_bytes_t &, amqp_message_t &)>;
 
+  struct StreamHeader {
+    amqp_channel_t channel;
+    uint64_t deliveryTag;
+    bool redelivered;
+    std::string consumerTag;
+    std::string exchange;
+    std::string routingKey;
+    uint64_t bodySize;
+  };
+
+  //  chunk is only valid for the duration of the call; last is set on the final chunk of the body
+  using ChunkSink = std::function<void(const StreamHeader &, std::string_view chunk, bool last)>;
+
   class RabbitMQConsumer {
    public:
-    RabbitMQConsumer() : connection(nullptr), socket(nullptr), channelOpen(false), consumerCb(nullCallback) {
+    RabbitMQConsumer()
+        : connection(nullptr), socket(nullptr), channelOpen(false), activeChannel(0), ackMode(false),
+          consumerCb(nullCallback) {
       connection = amqp_new_connection();
       if (!connection) {
         throw std::runtime_error("create connection failed");
@@ -72,9 +94,133 @@ namespace RabbitMQCpp {
       }
       consumerCb(envelope.channel, envelope.consumer_tag, envelope.message);
 
+      if (ackMode &&
+          amqp_basic_ack(connection, envelope.channel, envelope.delivery_tag, 0) != AMQP_STATUS_OK) {
+        amqp_destroy_envelope(&envelope);
+        throw std::runtime_error("basic ack failed");
+      }
+
       amqp_destroy_envelope(&envelope);
     }
 
+    //  hands each delivery to the dispatcher instead of running the callback inline; waits at most
+    //  ackInterval for a message so that completed work is acked promptly even when the queue goes quiet
+    void consume(KeyedDispatcher &dispatcher,
+                 const std::chrono::microseconds ackInterval = std::chrono::milliseconds(10)) {
+      amqp_envelope_t envelope;
+
+      settle(dispatcher);
+      amqp_maybe_release_buffers(connection);
+
+      timeval timeout{static_cast<time_t>(ackInterval.count() / 1000000),
+                      static_cast<suseconds_t>(ackInterval.count() % 1000000)};
+      auto reply = amqp_consume_message(connection, &envelope, &timeout, 0);
+      if (reply.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION && reply.library_error == AMQP_STATUS_TIMEOUT) {
+        return;
+      }
+      if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+        throw std::runtime_error("consume message failed");
+      }
+      std::unique_ptr<amqp_envelope_t, decltype(&amqp_destroy_envelope)> envelopeGuard(&envelope,
+                                                                                       amqp_destroy_envelope);
+      dispatcher.dispatch(envelope);
+    }
+
+    //  acks must go out on the thread that owns the connection; failed deliveries are nacked without requeue
+    //  (so they dead-letter if the queue has a DLX) before the watermark ack can cover them
+    void settle(KeyedDispatcher &dispatcher) {
+      auto settlement = dispatcher.collect();
+      if (!ackMode) {
+        return;
+      }
+
+      for (auto tag : settlement.rejected) {
+        if (amqp_basic_nack(connection, activeChannel, tag, 0, 0) != AMQP_STATUS_OK) {
+          throw std::runtime_error("basic nack failed");
+        }
+      }
+      if (settlement.ackUpTo &&
+          amqp_basic_ack(connection, activeChannel, settlement.ackUpTo, 1) != AMQP_STATUS_OK) {
+        throw std::runtime_error("basic ack failed");
+      }
+    }
+
+    //  reads the delivery frame by frame and hands each body fragment to the sink as it arrives, so memory
+    //  use is bounded by frame_max rather than by message size. If the sink throws, the rest of the body is
+    //  drained so the connection stays in step, the delivery is nacked without requeue and the error is
+    //  rethrown.
+    void consumeStream(const ChunkSink &sink) {
+      amqp_frame_t frame;
+
+      amqp_maybe_release_buffers(connection);
+      if (amqp_simple_wait_frame(connection, &frame) != AMQP_STATUS_OK) {
+        throw std::runtime_error("wait frame failed");
+      }
+      if (frame.frame_type != AMQP_FRAME_METHOD || frame.payload.method.id != AMQP_BASIC_DELIVER_METHOD) {
+        throw std::runtime_error(std::format("unexpected frame while waiting for delivery [type: {}]",
+                                             static_cast<int>(frame.frame_type)));
+      }
+
+      auto deliver = static_cast<amqp_basic_deliver_t *>(frame.payload.method.decoded);
+      StreamHeader header{frame.channel,
+                          deliver->delivery_tag,
+                          static_cast<bool>(deliver->redelivered),
+                          byteString(deliver->consumer_tag),
+                          byteString(deliver->exchange),
+                          byteString(deliver->routing_key),
+                          0};
+
+      if (amqp_simple_wait_frame_on_channel(connection, header.channel, &frame) != AMQP_STATUS_OK) {
+        throw std::runtime_error("wait frame failed");
+      }
+      if (frame.frame_type != AMQP_FRAME_HEADER) {
+        throw std::runtime_error("expected content header");
+      }
+      header.bodySize = frame.payload.properties.body_size;
+
+      std::exception_ptr failure;
+      auto deliverChunk = [&](std::string_view chunk, bool last) {
+        if (failure) {
+          return;
+        }
+        try {
+          sink(header, chunk, last);
+        } catch (...) {
+          failure = std::current_exception();
+        }
+      };
+
+      if (header.bodySize == 0) {
+        deliverChunk({}, true);
+      }
+
+      uint64_t received = 0;
+      while (received < header.bodySize) {
+        amqp_maybe_release_buffers_on_channel(connection, header.channel);
+        if (amqp_simple_wait_frame_on_channel(connection, header.channel, &frame) != AMQP_STATUS_OK) {
+          throw std::runtime_error("wait frame failed");
+        }
+        if (frame.frame_type != AMQP_FRAME_BODY) {
+          throw std::runtime_error("expected content body");
+        }
+        const auto &fragment = frame.payload.body_fragment;
+        received += fragment.len;
+        deliverChunk(std::string_view(static_cast<const char *>(fragment.bytes), fragment.len),
+                     received >= header.bodySize);
+      }
+
+      if (ackMode) {
+        auto status = failure ? amqp_basic_nack(connection, header.channel, header.deliveryTag, 0, 0)
+                              : amqp_basic_ack(connection, header.channel, header.deliveryTag, 0);
+        if (status != AMQP_STATUS_OK) {
+          throw std::runtime_error("stream settle failed");
+        }
+      }
+      if (failure) {
+        std::rethrow_exception(failure);
+      }
+    }
+
     void setCallback(ConsumerCallback callback) {
       consumerCb = ConsumerCallback(std::forward<decltype(callback)>(callback));
     }
@@ -83,6 +229,8 @@ namespace RabbitMQCpp {
     amqp_connection_state_t connection;
     amqp_socket_t *socket;
     bool channelOpen;
+    amqp_channel_t activeChannel;
+    bool ackMode;
     ConsumerCallback consumerCb;
 
     void openChannel(const int channelId) {
@@ -92,6 +240,14 @@ namespace RabbitMQCpp {
         throw std::runtime_error("channel open failed");
       }
       channelOpen = true;
+      activeChannel = channelId;
+    }
+
+    void setQos(const ConsumerConfiguration &config) {
+      if (config.prefetchCount) {
+        amqp_basic_qos(connection, config.channelId, 0, config.prefetchCount, 0);
+        throwOnError("basic qos failed");
+      }
     }
 
     std ::string byteString(const amqp_bytes_t &bytes) {
@@ -113,8 +269,10 @@ namespace RabbitMQCpp {
     void prepare(const ConsumerConfiguration &config, ConsumerCallback &&callback) override {
       auto dyconfig = dynamic_cast<const DirectConsumerConfiguration *>(&config);
       openChannel(config.channelId);
+      setQos(config);
+      ackMode = config.manualAck;
       amqp_basic_consume(connection, config.channelId, amqp_cstring_bytes(dyconfig->queue.c_str()),
-                         amqp_empty_bytes, 0, 1, 0, amqp_empty_table);
+                         amqp_empty_bytes, 0, !ackMode, 0, amqp_empty_table);
       throwOnError("basic consume failed");
 
       setCallback(callback);
@@ -128,6 +286,8 @@ namespace RabbitMQCpp {
 
       auto dyconfig = dynamic_cast<const SubscriberConfiguration *>(&config);
       openChannel(config.channelId);
+      setQos(config);
+      ackMode = true;
 
       amqp_exchange_declare(connection, channelId, amqp_cstring_bytes(dyconfig->exchange.c_str()),
                             amqp_cstring_bytes("fanout"), 0, 1, 0, 0, amqp_empty_table);
@@ -159,6 +319,8 @@ namespace RabbitMQCpp {
       const auto channelId = config.channelId;
       auto dyconfig = dynamic_cast<const TopicConsumerConfiguration *>(&config);
       openChannel(config.channelId);
+      setQos(config);
+      ackMode = true;
 
       amqp_exchange_declare(connection, channelId, amqp_cstring_bytes(dyconfig->exchange.c_str()),
                             amqp_cstring_bytes("topic"), 0, 1, 0, 0, amqp_empty_table);
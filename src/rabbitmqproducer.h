@@ -4,7 +4,9 @@
 #include <rabbitmq-c/amqp.h>
 #include <rabbitmq-c/tcp_socket.h>
 
+#include <algorithm>
 #include <concepts>
+#include <cstdint>
 #include <cstring>
 #include <filesystem>
 #include <format>
@@ -17,15 +19,19 @@
 #include <vector>
 
 #include "config.h"
+#include "mappedfile.h"
 #include "sendconcept.h"
 
 using namespace std::string_literals;
 
 namespace RabbitMQCpp {
+  //  fills at most capacity bytes of buffer with the next part of the body and returns how many it wrote
+  using ChunkGenerator = std::function<std::size_t(char *buffer, std::size_t capacity)>;
+
   template <typename Derived>
   class RabbitMQProducer {
    public:
-    RabbitMQProducer() : connection(nullptr), socket(nullptr), channelOpen(false) {
+    RabbitMQProducer() : connection(nullptr), socket(nullptr), channelOpen(false), contentPending(false) {
       static_assert(HasVoidSendMember<Derived>,
                     "Derived class must have a send(...) member function that returns void");
 
@@ -40,7 +46,7 @@ namespace RabbitMQCpp {
     }
 
     virtual ~RabbitMQProducer() {
-      if (channelOpen) {
+      if (channelOpen && !contentPending) {
         amqp_channel_close(connection, 1, AMQP_REPLY_SUCCESS);
       }
 
@@ -68,6 +74,7 @@ namespace RabbitMQCpp {
     amqp_connection_state_t connection;
     amqp_socket_t *socket;
     bool channelOpen;
+    bool contentPending;  //  set from basic.publish until the last body frame; stays set if a stream fails
 
     void openChannel(const int channelId) {
       amqp_channel_open(connection, channelId);
@@ -100,18 +107,113 @@ namespace RabbitMQCpp {
         throw std::runtime_error(std::move(msg));
       }
     }
+
+    //  a content body frame carries frame_max less the 7 byte frame header and 1 byte end marker
+    std::size_t bodyFrameSize() { return static_cast<std::size_t>(amqp_get_frame_max(connection)) - 8; }
+
+    //  the broker is still waiting for body frames after an interrupted stream and would close the connection
+    //  on any other frame, so refuse to send rather than corrupt it
+    void throwIfInterrupted() {
+      if (contentPending) {
+        throw std::runtime_error("producer unusable: an earlier streamed publish was interrupted");
+      }
+    }
+
+    //  basic.publish followed by the content header; the body frames must follow on the same channel and
+    //  contentPending must be cleared once the last has been sent
+    void beginPublish(const amqp_channel_t channelId, const amqp_bytes_t exchange,
+                      const amqp_bytes_t routingKey, const uint64_t bodySize) {
+      throwIfInterrupted();
+      contentPending = true;
+
+      amqp_basic_publish_t method{};
+      method.exchange = exchange;
+      method.routing_key = routingKey;
+      if (amqp_send_method(connection, channelId, AMQP_BASIC_PUBLISH_METHOD, &method) != AMQP_STATUS_OK) {
+        throw std::runtime_error("publish failed");
+      }
+
+      amqp_basic_properties_t props{};
+      amqp_frame_t header{};
+      header.frame_type = AMQP_FRAME_HEADER;
+      header.channel = channelId;
+      header.payload.properties.class_id = AMQP_BASIC_CLASS;
+      header.payload.properties.body_size = bodySize;
+      header.payload.properties.decoded = &props;
+      if (amqp_send_frame(connection, &header) != AMQP_STATUS_OK) {
+        throw std::runtime_error("send content header failed");
+      }
+    }
+
+    //  the library encodes the fragment into its frame-sized output buffer (one copy) before writing it
+    void sendBodyFrame(const amqp_channel_t channelId, const amqp_bytes_t fragment) {
+      amqp_frame_t body{};
+      body.frame_type = AMQP_FRAME_BODY;
+      body.channel = channelId;
+      body.payload.body_fragment = fragment;
+      if (amqp_send_frame(connection, &body) != AMQP_STATUS_OK) {
+        throw std::runtime_error("send content body failed");
+      }
+    }
+
+    //  only one frame's worth of the body is ever held in memory
+    void publishStream(const amqp_channel_t channelId, const amqp_bytes_t exchange,
+                       const amqp_bytes_t routingKey, const uint64_t bodySize, const ChunkGenerator &next) {
+      beginPublish(channelId, exchange, routingKey, bodySize);
+
+      std::vector<char> buffer(std::min<uint64_t>(bodyFrameSize(), bodySize));
+      uint64_t sent = 0;
+      while (sent < bodySize) {
+        const auto capacity = static_cast<std::size_t>(std::min<uint64_t>(buffer.size(), bodySize - sent));
+        const auto len = next(buffer.data(), capacity);
+        if (len == 0 || len > capacity) {
+          throw std::runtime_error(
+              std::format("chunk generator returned {} bytes at offset {} of {}", len, sent, bodySize));
+        }
+        sendBodyFrame(channelId, amqp_bytes_t{len, buffer.data()});
+        sent += len;
+      }
+      contentPending = false;
+    }
+
+    //  each body frame is read from the mapping and copied once into the library's frame-sized output buffer;
+    //  pages are dropped once sent, so resident memory stays around one frame regardless of file size
+    void publishFile(const amqp_channel_t channelId, const amqp_bytes_t exchange,
+                     const amqp_bytes_t routingKey, const std::filesystem::path &path) {
+      MappedFile file(path);
+      beginPublish(channelId, exchange, routingKey, file.size());
+
+      const auto frameSize = bodyFrameSize();
+      for (std::size_t offset = 0; offset < file.size(); offset += frameSize) {
+        const auto len = std::min(frameSize, file.size() - offset);
+        sendBodyFrame(channelId, amqp_bytes_t{len, const_cast<char *>(file.data() + offset)});
+        file.release(offset + len);
+      }
+      contentPending = false;
+    }
   };  // RabbitMQProducer
 
   class RabbitMQDirectProducer : public RabbitMQProducer<RabbitMQDirectProducer> {
    public:
     void prepare(const ProducerConfiguration &config) { openChannel(config.channelId); }
     void send(const ProducerConfiguration &config, const std::string &msg) {
+      throwIfInterrupted();
       auto dyconfig = dynamic_cast<const DirectProducerConfiguration *>(&config);
 
       amqp_basic_publish(connection, 1, amqp_empty_bytes, amqp_cstring_bytes(dyconfig->queue.c_str()), 0, 0,
                          NULL, amqp_cstring_bytes(msg.c_str()));
       throwOnError("publish failed", true);
     }
+    void sendStream(const ProducerConfiguration &config, const uint64_t bodySize,
+                    const ChunkGenerator &next) {
+      auto dyconfig = dynamic_cast<const DirectProducerConfiguration *>(&config);
+      publishStream(config.channelId, amqp_empty_bytes, amqp_cstring_bytes(dyconfig->queue.c_str()), bodySize,
+                    next);
+    }
+    void sendFile(const ProducerConfiguration &config, const std::filesystem::path &path) {
+      auto dyconfig = dynamic_cast<const DirectProducerConfiguration *>(&config);
+      publishFile(config.channelId, amqp_empty_bytes, amqp_cstring_bytes(dyconfig->queue.c_str()), path);
+    }
     void foo(const std::string &s, const unsigned long u, const bool b) {}
   };
 
@@ -127,12 +229,25 @@ namespace RabbitMQCpp {
     }
 
     void send(const ProducerConfiguration &config, const std::string &msg) {
+      throwIfInterrupted();
       auto dyconfig = dynamic_cast<const PublisherConfiguration *>(&config);
       amqp_basic_publish(connection, 1, amqp_cstring_bytes(dyconfig->exchange.c_str()), amqp_empty_bytes, 0,
                          0, NULL, amqp_cstring_bytes(msg.c_str()));
       throwOnError("publish failed", true);
     }
 
+    void sendStream(const ProducerConfiguration &config, const uint64_t bodySize,
+                    const ChunkGenerator &next) {
+      auto dyconfig = dynamic_cast<const PublisherConfiguration *>(&config);
+      publishStream(config.channelId, amqp_cstring_bytes(dyconfig->exchange.c_str()), amqp_empty_bytes,
+                    bodySize, next);
+    }
+
+    void sendFile(const ProducerConfiguration &config, const std::filesystem::path &path) {
+      auto dyconfig = dynamic_cast<const PublisherConfiguration *>(&config);
+      publishFile(config.channelId, amqp_cstring_bytes(dyconfig->exchange.c_str()), amqp_empty_bytes, path);
+    }
+
     void foo(const std::string &s, const unsigned long u, const bool b) {}
   };
 
@@ -147,11 +262,24 @@ namespace RabbitMQCpp {
       throwOnError("declare exchange failed");
     }
     void send(const ProducerConfiguration &config, const std::string &key, const std::string &msg) {
+      throwIfInterrupted();
       auto dyconfig = dynamic_cast<const TopicProducerConfiguration *>(&config);
       amqp_basic_publish(connection, 1, amqp_cstring_bytes(dyconfig->exchange.c_str()),
                          amqp_cstring_bytes(key.c_str()), 0, 0, NULL, amqp_cstring_bytes(msg.c_str()));
       throwOnError("publish failed", true);
     }
+    void sendStream(const ProducerConfiguration &config, const std::string &key, const uint64_t bodySize,
+                    const ChunkGenerator &next) {
+      auto dyconfig = dynamic_cast<const TopicProducerConfiguration *>(&config);
+      publishStream(config.channelId, amqp_cstring_bytes(dyconfig->exchange.c_str()),
+                    amqp_cstring_bytes(key.c_str()), bodySize, next);
+    }
+    void sendFile(const ProducerConfiguration &config, const std::string &key,
+                  const std::filesystem::path &path) {
+      auto dyconfig = dynamic_cast<const TopicProducerConfiguration *>(&config);
+      publishFile(config.channelId, amqp_cstring_bytes(dyconfig->exchange.c_str()),
+                  amqp_cstring_bytes(key.c_str()), path);
+    }
   };
 };  // namespace RabbitMQCpp
 #endif
\ No newline at end of file
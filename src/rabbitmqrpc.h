@@ -0,0 +1,388 @@
+#ifndef __RABBITMQRPC_H__
+#define __RABBITMQRPC_H__
+
+#include <poll.h>
+#include <rabbitmq-c/amqp.h>
+#include <rabbitmq-c/tcp_socket.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "rabbitmqconsumer.h"
+
+namespace RabbitMQCpp {
+  using RpcHandler = std::function<std::string(const amqp_message_t &)>;
+
+  //  pipelined request/response over a single connection using the direct reply-to pseudo-queue, so no reply
+  //  queue is ever declared. call() may be used from any thread; a private I/O thread owns the connection,
+  //  publishes queued requests, matches replies by correlation id and fails requests whose deadline passes.
+  class RabbitMQRpcClient {
+   public:
+    RabbitMQRpcClient() : connection(nullptr), socket(nullptr), channelOpen(false), channelId(0), wakeFd(-1),
+                          nextId(0), closed(false) {
+      connection = amqp_new_connection();
+      if (!connection) {
+        throw std::runtime_error("create connection failed");
+      }
+      socket = amqp_tcp_socket_new(connection);
+      if (!socket) {
+        throw std::runtime_error(std::format("create TCP socket failed: {}", std::strerror(errno)));
+      }
+      wakeFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (wakeFd < 0) {
+        throw std::runtime_error(std::format("create eventfd failed: {}", std::strerror(errno)));
+      }
+    }
+
+    RabbitMQRpcClient(const RabbitMQRpcClient &) = delete;
+    RabbitMQRpcClient &operator=(const RabbitMQRpcClient &) = delete;
+
+    ~RabbitMQRpcClient() {
+      if (io.joinable()) {
+        io.request_stop();
+        wake();
+        io.join();
+      }
+      shutdown("rpc client closed");
+
+      if (channelOpen) {
+        amqp_channel_close(connection, channelId, AMQP_REPLY_SUCCESS);
+      }
+
+      if (connection) {
+        amqp_connection_close(connection, AMQP_REPLY_SUCCESS);
+      }
+
+      amqp_destroy_connection(connection);
+      if (wakeFd >= 0) {
+        ::close(wakeFd);
+      }
+    }
+
+    void login(const ConnectionConfiguration &config) {
+      if ((amqp_socket_open(socket, config.hostname.c_str(), config.port)) != 0) {
+        throw std::runtime_error("socket open failed");
+      }
+      auto loginResult = amqp_login(connection, config.vhost.c_str(), 0, 131072, 0, AMQP_SASL_METHOD_PLAIN,
+                                    config.username.c_str(), config.password.c_str());
+      if (loginResult.reply_type != AMQP_RESPONSE_NORMAL) {
+        throw std::runtime_error("Login failed");
+      }
+    }
+
+    //  the reply-to consumer must exist, in no-ack mode, before the first request is published on the channel
+    void prepare(const ProducerConfiguration &config) {
+      channelId = config.channelId;
+      amqp_channel_open(connection, channelId);
+      throwOnError("channel open failed");
+      channelOpen = true;
+
+      amqp_basic_consume(connection, channelId, amqp_cstring_bytes(replyTo), amqp_empty_bytes, 0, 1, 0,
+                         amqp_empty_table);
+      throwOnError("basic consume failed");
+
+      std::lock_guard lock(outboxMtx);
+      io = std::jthread([this](std::stop_token stop) { run(stop); });
+    }
+
+    //  the timeout is also sent as the message expiration so the broker drops requests nobody will wait for
+    std::future<std::string> call(const ProducerConfiguration &config, std::string msg,
+                                  const std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+      auto dyconfig = dynamic_cast<const DirectProducerConfiguration *>(&config);
+
+      //  the broker rejects a non-positive expiration with a channel error, which would fail every call
+      if (timeout <= std::chrono::milliseconds::zero()) {
+        return failedCall(std::format("rpc timeout must be positive, got {} ms", timeout.count()));
+      }
+
+      Request request{std::to_string(nextId++), dyconfig->queue, std::move(msg), timeout,
+                      std::chrono::steady_clock::now() + timeout, {}};
+      auto reply = request.reply.get_future();
+      {
+        std::lock_guard lock(outboxMtx);
+        if (closed) {
+          return failedCall(closeReason);
+        }
+        //  nothing would ever publish the request
+        if (!io.joinable()) {
+          return failedCall("rpc client not prepared");
+        }
+        outbox.push_back(std::move(request));
+      }
+      wake();
+      return reply;
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+    using Deadlines = std::multimap<Clock::time_point, std::string>;
+
+    struct Request {
+      std::string correlationId;
+      std::string queue;
+      std::string body;
+      std::chrono::milliseconds timeout;
+      Clock::time_point deadline;
+      std::promise<std::string> reply;
+    };
+
+    struct Pending {
+      std::promise<std::string> reply;
+      Deadlines::iterator deadline;
+    };
+
+    static constexpr const char *replyTo = "amq.rabbitmq.reply-to";
+
+    amqp_connection_state_t connection;
+    amqp_socket_t *socket;
+    bool channelOpen;
+    amqp_channel_t channelId;
+    int wakeFd;
+    std::atomic<uint64_t> nextId;
+
+    std::mutex outboxMtx;
+    std::vector<Request> outbox;
+    bool closed;
+    std::string closeReason;
+
+    //  only touched by the I/O thread
+    std::unordered_map<std::string, Pending> pending;
+    Deadlines deadlines;
+
+    std::jthread io;
+
+    static std::future<std::string> failedCall(const std::string &reason) {
+      std::promise<std::string> reply;
+      reply.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+      return reply.get_future();
+    }
+
+    void throwOnError(const std::string &msg) {
+      auto amqpResult = amqp_get_rpc_reply(connection);
+      if (amqpResult.reply_type != AMQP_RESPONSE_NORMAL) {
+        throw std::runtime_error(msg);
+      }
+    }
+
+    void wake() {
+      uint64_t one = 1;
+      [[maybe_unused]] auto written = ::write(wakeFd, &one, sizeof(one));
+    }
+
+    void run(std::stop_token stop) {
+      try {
+        while (!stop.stop_requested()) {
+          publishOutbox();
+
+          //  frames already pulled off the socket will not make it readable again
+          while (amqp_frames_enqueued(connection) || amqp_data_in_buffer(connection)) {
+            readReply();
+          }
+          expire(Clock::now());
+
+          pollfd fds[2] = {{amqp_get_sockfd(connection), POLLIN, 0}, {wakeFd, POLLIN, 0}};
+          if (::poll(fds, 2, pollTimeout()) < 0 && errno != EINTR) {
+            throw std::runtime_error(std::format("poll failed: {}", std::strerror(errno)));
+          }
+          if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            [[maybe_unused]] auto bytesRead = ::read(wakeFd, &count, sizeof(count));
+          }
+          if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            readReply();
+          }
+        }
+      } catch (const std::exception &e) {
+        shutdown(e.what());
+      }
+    }
+
+    void publishOutbox() {
+      std::vector<Request> batch;
+      {
+        std::lock_guard lock(outboxMtx);
+        batch.swap(outbox);
+      }
+
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        auto &request = batch[i];
+        auto expiration = std::to_string(request.timeout.count());
+
+        amqp_basic_properties_t props{};
+        props._flags = AMQP_BASIC_CORRELATION_ID_FLAG | AMQP_BASIC_REPLY_TO_FLAG | AMQP_BASIC_EXPIRATION_FLAG;
+        props.correlation_id = amqp_cstring_bytes(request.correlationId.c_str());
+        props.reply_to = amqp_cstring_bytes(replyTo);
+        props.expiration = amqp_cstring_bytes(expiration.c_str());
+
+        auto status = amqp_basic_publish(connection, channelId, amqp_empty_bytes,
+                                         amqp_cstring_bytes(request.queue.c_str()), 0, 0, &props,
+                                         amqp_bytes_t{request.body.size(), request.body.data()});
+        if (status != AMQP_STATUS_OK) {
+          auto reason = std::format("publish failed: {}", amqp_error_string2(status));
+          for (auto j = i; j < batch.size(); ++j) {
+            batch[j].reply.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+          }
+          throw std::runtime_error(reason);
+        }
+
+        auto deadline = deadlines.emplace(request.deadline, request.correlationId);
+        pending.emplace(std::move(request.correlationId), Pending{std::move(request.reply), deadline});
+      }
+    }
+
+    void readReply() {
+      amqp_envelope_t envelope;
+
+      amqp_maybe_release_buffers(connection);
+      auto reply = amqp_consume_message(connection, &envelope, NULL, 0);
+      if (reply.reply_type == AMQP_RESPONSE_LIBRARY_EXCEPTION &&
+          reply.library_error == AMQP_STATUS_UNEXPECTED_STATE) {
+        skipFrame();
+        return;
+      }
+      if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+        throw std::runtime_error("consume reply failed");
+      }
+
+      const auto &props = envelope.message.properties;
+      if (props._flags & AMQP_BASIC_CORRELATION_ID_FLAG) {
+        auto it = pending.find(std::string(static_cast<char *>(props.correlation_id.bytes),
+                                           props.correlation_id.len));
+        //  a miss is a reply that arrived after its request timed out
+        if (it != pending.end()) {
+          const auto &body = envelope.message.body;
+          it->second.reply.set_value(std::string(static_cast<char *>(body.bytes), body.len));
+          deadlines.erase(it->second.deadline);
+          pending.erase(it);
+        }
+      }
+
+      amqp_destroy_envelope(&envelope);
+    }
+
+    //  a non-delivery frame is waiting; a close from the broker ends the client, anything else is ignored
+    void skipFrame() {
+      amqp_frame_t frame;
+      if (amqp_simple_wait_frame(connection, &frame) != AMQP_STATUS_OK) {
+        throw std::runtime_error("wait frame failed");
+      }
+      if (frame.frame_type != AMQP_FRAME_METHOD) {
+        return;
+      }
+      if (frame.payload.method.id == AMQP_CHANNEL_CLOSE_METHOD ||
+          frame.payload.method.id == AMQP_CONNECTION_CLOSE_METHOD) {
+        channelOpen = false;
+        throw std::runtime_error("channel closed by broker");
+      }
+    }
+
+    void expire(const Clock::time_point now) {
+      while (!deadlines.empty() && deadlines.begin()->first <= now) {
+        auto it = pending.find(deadlines.begin()->second);
+        if (it != pending.end()) {
+          it->second.reply.set_exception(std::make_exception_ptr(std::runtime_error("rpc timed out")));
+          pending.erase(it);
+        }
+        deadlines.erase(deadlines.begin());
+      }
+    }
+
+    int pollTimeout() {
+      if (deadlines.empty()) {
+        return -1;
+      }
+      auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadlines.begin()->first - Clock::now());
+      return static_cast<int>(std::max<std::chrono::milliseconds::rep>(wait.count(), 0));
+    }
+
+    //  fails everything outstanding; later calls fail immediately with the same reason
+    void shutdown(const std::string &reason) {
+      std::vector<Request> unsent;
+      {
+        std::lock_guard lock(outboxMtx);
+        if (!closed) {
+          closed = true;
+          closeReason = reason;
+        }
+        unsent.swap(outbox);
+      }
+
+      for (auto &request : unsent) {
+        request.reply.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+      }
+      for (auto &[id, request] : pending) {
+        request.reply.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+      }
+      pending.clear();
+      deadlines.clear();
+    }
+  };  // RabbitMQRpcClient
+
+  //  consumes requests from a named queue and publishes each handler result straight back to the request's
+  //  reply-to address with its correlation id; nothing is declared per call
+  class RabbitMQRpcServer : public RabbitMQDirectConsumer {
+   public:
+    void serve(const RpcHandler &handler) {
+      amqp_envelope_t envelope;
+
+      amqp_maybe_release_buffers(connection);
+
+      auto reply = amqp_consume_message(connection, &envelope, NULL, 0);
+      if (reply.reply_type != AMQP_RESPONSE_NORMAL) {
+        throw std::runtime_error("consume message failed");
+      }
+
+      std::unique_ptr<amqp_envelope_t, decltype(&amqp_destroy_envelope)> envelopeGuard(&envelope,
+                                                                                       amqp_destroy_envelope);
+
+      //  a failed request is dropped (dead-lettered if the queue has a DLX) rather than redelivered forever
+      std::string response;
+      try {
+        response = handler(envelope.message);
+      } catch (...) {
+        if (ackMode) {
+          amqp_basic_nack(connection, envelope.channel, envelope.delivery_tag, 0, 0);
+        }
+        throw;
+      }
+
+      const auto &props = envelope.message.properties;
+      if (props._flags & AMQP_BASIC_REPLY_TO_FLAG) {
+        amqp_basic_properties_t replyProps{};
+        if (props._flags & AMQP_BASIC_CORRELATION_ID_FLAG) {
+          replyProps._flags = AMQP_BASIC_CORRELATION_ID_FLAG;
+          replyProps.correlation_id = props.correlation_id;
+        }
+        auto status = amqp_basic_publish(connection, envelope.channel, amqp_empty_bytes, props.reply_to, 0, 0,
+                                         &replyProps, amqp_bytes_t{response.size(), response.data()});
+        if (status != AMQP_STATUS_OK) {
+          throw std::runtime_error("reply failed");
+        }
+      }
+
+      if (ackMode &&
+          amqp_basic_ack(connection, envelope.channel, envelope.delivery_tag, 0) != AMQP_STATUS_OK) {
+        throw std::runtime_error("basic ack failed");
+      }
+    }
+  };  // RabbitMQRpcServer
+};  // namespace RabbitMQCpp
+#endif
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "rabbitmqrpc.h"
+
+using json = nlohmann::json;
+using namespace std::string_literals;
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    throw std::runtime_error("Queue name missing");
+  }
+  std::cout << "RPC CLIENT\n";
+  auto connConfig = RabbitMQCpp::loadConnectionConfiguration("config/config.json");
+
+  RabbitMQCpp::DirectProducerConfiguration rpcConfig(argv[1]);
+
+  RabbitMQCpp::RabbitMQRpcClient client;
+  client.login(connConfig);
+  client.prepare(rpcConfig);
+
+  const auto count = argc > 2 ? std::stoi(argv[2]) : 1000;
+
+  //  all requests are in flight at once; replies are matched up by correlation id
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::future<std::string>> replies;
+  replies.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    replies.push_back(client.call(rpcConfig, std::format("request {}", i)));
+  }
+
+  auto failed = 0;
+  for (auto &reply : replies) {
+    try {
+      reply.get();
+    } catch (const std::exception &) {
+      ++failed;
+    }
+  }
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+  std::cout << std::format("{} calls, {} failed, {} us total, {:.1f} us per call\n", count, failed,
+                           elapsed.count(), static_cast<double>(elapsed.count()) / count);
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+
+#include "config.h"
+#include "rabbitmqrpc.h"
+
+using json = nlohmann::json;
+
+std::string echo(const amqp_message_t &request);
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    throw std::runtime_error("Queue name missing");
+  }
+  std::cout << "RPC SERVER\n";
+  auto connConfig = RabbitMQCpp::loadConnectionConfiguration("config/config.json");
+
+  RabbitMQCpp::DirectConsumerConfiguration serverConfig(argv[1]);
+  serverConfig.manualAck = true;
+  serverConfig.prefetchCount = 256;
+
+  RabbitMQCpp::RabbitMQRpcServer server;
+  server.login(connConfig);
+  server.prepare(serverConfig, [](amqp_channel_t, amqp_bytes_t &, amqp_message_t &) {});
+
+  while (true) {
+    server.serve(echo);
+  }
+
+  return 0;
+}
+
+std::string echo(const amqp_message_t &request) {
+  return "echo: " + std::string(static_cast<char *>(request.body.bytes), request.body.len);
+}
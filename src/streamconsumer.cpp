@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+
+#include "config.h"
+#include "rabbitmqconsumer.h"
+
+using json = nlohmann::json;
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    throw std::runtime_error("Queue name and output directory missing");
+  }
+  std::cout << "STREAM CONSUME\n";
+  auto connConfig = RabbitMQCpp::loadConnectionConfiguration("config/config.json");
+
+  RabbitMQCpp::DirectConsumerConfiguration consumerConfig(argv[1]);
+  consumerConfig.manualAck = true;
+
+  RabbitMQCpp::RabbitMQDirectConsumer consumer;
+  consumer.login(connConfig);
+  consumer.prepare(consumerConfig, [](amqp_channel_t, amqp_bytes_t &, amqp_message_t &) {});
+
+  const std::filesystem::path outDir(argv[2]);
+  std::ofstream out;
+  uint64_t currentTag = 0;
+  std::filesystem::path currentPath;
+
+  //  each delivery is written to <output directory>/<delivery tag> one frame at a time; a new tag always
+  //  starts a new file, even if the previous delivery was cut short
+  RabbitMQCpp::ChunkSink sink = [&](const RabbitMQCpp::StreamHeader &header, std::string_view chunk,
+                                    bool last) {
+    if (header.deliveryTag != currentTag) {
+      out.close();
+      out.clear();
+      currentTag = header.deliveryTag;
+      currentPath = outDir / std::to_string(currentTag);
+      out.open(currentPath, std::ios::binary);
+      if (!out) {
+        throw std::runtime_error(std::format("open {} failed", currentPath.string()));
+      }
+    }
+    out.write(chunk.data(), chunk.size());
+    if (!out) {
+      throw std::runtime_error(std::format("write to {} failed", currentPath.string()));
+    }
+    if (last) {
+      out.close();
+      std::cout << "RECEIVED " << header.deliveryTag << " " << header.bodySize << " bytes\n";
+    }
+  };
+
+  while (true) {
+    consumer.consumeStream(sink);
+  }
+
+  return 0;
+}
@@ -0,0 +1,28 @@
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+
+#include "config.h"
+#include "rabbitmqproducer.h"
+
+using json = nlohmann::json;
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    throw std::runtime_error("Queue name and file path missing");
+  }
+  std::cout << "STREAM PRODUCE\n";
+  auto connConfig = RabbitMQCpp::loadConnectionConfiguration("config/config.json");
+
+  RabbitMQCpp::DirectProducerConfiguration producerConfig(argv[1]);
+
+  RabbitMQCpp::RabbitMQDirectProducer producer;
+  producer.login(connConfig);
+
+  producer.prepare(producerConfig);
+  producer.sendFile(producerConfig, argv[2]);
+
+  return 0;
+}
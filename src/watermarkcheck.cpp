@@ -0,0 +1,93 @@
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "keyeddispatcher.h"
+
+//  exercises AckWatermark and KeyedDispatcher settlement without a broker; exits non-zero on any mismatch
+int failures = 0;
+
+void expect(const std::string &what, const RabbitMQCpp::Settlement &settlement,
+            const std::vector<uint64_t> &rejected, const uint64_t ackUpTo) {
+  if (settlement.rejected != rejected || settlement.ackUpTo != ackUpTo) {
+    std::cout << std::format("FAIL {}: ackUpTo {} (expected {})\n", what, settlement.ackUpTo, ackUpTo);
+    ++failures;
+  }
+}
+
+int main() {
+  RabbitMQCpp::AckWatermark watermark;
+  for (uint64_t tag = 1; tag <= 8; ++tag) {
+    watermark.dispatched(tag);
+  }
+
+  expect("nothing completed", watermark.collect(), {}, 0);
+
+  watermark.completed(1);
+  watermark.completed(2);
+  watermark.completed(3, true);
+  expect("last completed tag failed", watermark.collect(), {3}, 2);
+
+  watermark.completed(4, true);
+  watermark.completed(5, true);
+  expect("all new tags failed", watermark.collect(), {4, 5}, 0);
+
+  watermark.completed(6);
+  expect("ack after failures", watermark.collect(), {}, 6);
+
+  watermark.completed(8);
+  expect("gap below completed tag", watermark.collect(), {}, 0);
+
+  watermark.completed(7, true);
+  expect("failed tag fills gap", watermark.collect(), {7}, 8);
+
+  RabbitMQCpp::AckWatermark fresh;
+  fresh.dispatched(1);
+  fresh.completed(1, true);
+  expect("first delivery failed", fresh.collect(), {1}, 0);
+
+  //  tag 2 fails in the key extractor on the I/O thread, before it reaches a lane
+  RabbitMQCpp::KeyedDispatcher dispatcher([](const RabbitMQCpp::Delivery &) {}, 2,
+                                          [](const amqp_envelope_t &envelope) -> std::string {
+                                            if (envelope.delivery_tag == 2) {
+                                              throw std::runtime_error("no key");
+                                            }
+                                            return "key";
+                                          });
+  bool threw = false;
+  for (uint64_t tag = 1; tag <= 3; ++tag) {
+    amqp_envelope_t envelope{};
+    envelope.delivery_tag = tag;
+    try {
+      dispatcher.dispatch(envelope);
+    } catch (const std::runtime_error &) {
+      threw = tag == 2;
+    }
+  }
+
+  RabbitMQCpp::Settlement settled{{}, 0};
+  auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (settled.ackUpTo != 3 && std::chrono::steady_clock::now() < giveUp) {
+    auto settlement = dispatcher.collect();
+    settled.rejected.insert(settled.rejected.end(), settlement.rejected.begin(), settlement.rejected.end());
+    if (settlement.ackUpTo) {
+      settled.ackUpTo = settlement.ackUpTo;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  if (!threw) {
+    std::cout << "FAIL key extractor exception was not rethrown\n";
+    ++failures;
+  }
+  expect("tag failed before reaching a lane", settled, {2}, 3);
+
+  if (!failures) {
+    std::cout << "OK\n";
+  }
+  return failures ? 1 : 0;
+}